@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture.h"
+#include "host.h"
+
+#define CAPTURE_STREAM_BUFFER (1 << 20)
+
+// Split a 0xRRGGBBAA color, converting it to BT.601 YUV for Y4M
+static void capture_color(uint8_t out[3], uint32_t color,
+                          capture_format_t format) {
+  const int32_t r = (color >> 24) & 0xFF;
+  const int32_t g = (color >> 16) & 0xFF;
+  const int32_t b = (color >> 8) & 0xFF;
+
+  if (format == CAPTURE_PPM) {
+    out[0] = r;
+    out[1] = g;
+    out[2] = b;
+  } else {
+    out[0] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+    out[1] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+    out[2] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+  }
+}
+
+// path "-" writes to stdout
+int open_capture(capture_t *capture, const char *path, capture_format_t format,
+                 bool changed_only, const config_t config) {
+  *capture = (capture_t){
+      .format = format,
+      .changed_only = changed_only,
+      .width = CHIP8_DISPLAY_WIDTH * config.scale_factor,
+      .height = CHIP8_DISPLAY_HEIGHT * config.scale_factor,
+      .scale_factor = config.scale_factor,
+      .window_width = CHIP8_DISPLAY_WIDTH,
+      .window_height = CHIP8_DISPLAY_HEIGHT,
+  };
+  capture_color(capture->fg, config.fg_color, format);
+  capture_color(capture->bg, config.bg_color, format);
+
+  // Each frame is written with its header in a single call. Y4M has a stream
+  // header followed by per-frame headers, PPM repeats the image header
+  char header[64];
+  if (format == CAPTURE_Y4M) {
+    capture->header_size = snprintf(header, sizeof header, "FRAME\n");
+  } else {
+    capture->header_size = snprintf(header, sizeof header, "P6\n%u %u\n255\n",
+                                    capture->width, capture->height);
+  }
+  capture->buffer_size =
+      capture->header_size + (size_t)capture->width * capture->height * 3;
+  capture->buffer = malloc(capture->buffer_size);
+  if (capture->buffer == NULL) {
+    fprintf(stderr, "Could not allocate %zu bytes capture buffer\n",
+            capture->buffer_size);
+    return 1;
+  }
+  memcpy(capture->buffer, header, capture->header_size);
+
+  capture->out = (strcmp(path, "-") == 0) ? stdout : fopen(path, "wb");
+  if (capture->out == NULL) {
+    fprintf(stderr, "Could not open capture file %s\n", path);
+    free(capture->buffer);
+    return 1;
+  }
+  // glibc ignores the size of a buffer it allocates itself, so pass one.
+  // Without it the stream keeps its default buffer
+  capture->stream_buffer = malloc(CAPTURE_STREAM_BUFFER);
+  if (capture->stream_buffer) {
+    setvbuf(capture->out, capture->stream_buffer, _IOFBF,
+            CAPTURE_STREAM_BUFFER);
+  }
+
+  if (format == CAPTURE_Y4M &&
+      fprintf(capture->out, "YUV4MPEG2 W%u H%u F60:1 Ip A1:1 C444\n",
+              capture->width, capture->height) < 0) {
+    fprintf(stderr, "Could not write capture header\n");
+    close_capture(capture);
+    return 1;
+  }
+
+  return 0;
+}
+
+// Fill one scaled line of CHIP8 row y, then copy it for the other lines of
+// the same row
+static void render_row(uint8_t *line, size_t stride, const bool *row,
+                       uint32_t width, uint32_t scale, size_t lines,
+                       const uint8_t *on, const uint8_t *off) {
+  uint8_t *p = line;
+  for (uint32_t x = 0; x < width; x++) {
+    const uint8_t *color = row[x] ? on : off;
+    if (stride == 1) {
+      memset(p, *color, scale);
+      p += scale;
+      continue;
+    }
+    for (uint32_t s = 0; s < scale; s++) {
+      memcpy(p, color, stride);
+      p += stride;
+    }
+  }
+
+  const size_t line_size = (size_t)width * scale * stride;
+  for (size_t l = 1; l < lines; l++) {
+    memcpy(line + l * line_size, line, line_size);
+  }
+}
+
+int capture_frame(capture_t *capture, const chip8_t *chip8) {
+  const bool *display = chip8_get_display(chip8);
+  const size_t display_size = capture->window_width * capture->window_height;
+
+  if (capture->changed_only && capture->has_last &&
+      memcmp(capture->last_display, display, display_size) == 0)
+    return 0;
+  memcpy(capture->last_display, display, display_size);
+  capture->has_last = true;
+
+  uint8_t *pixels = capture->buffer + capture->header_size;
+  const size_t block_size = (size_t)capture->width * capture->scale_factor;
+
+  for (uint32_t y = 0; y < capture->window_height; y++) {
+    const bool *row = &display[y * capture->window_width];
+
+    if (capture->format == CAPTURE_PPM) {
+      // Interleaved RGB
+      render_row(pixels + y * block_size * 3, 3, row, capture->window_width,
+                 capture->scale_factor, capture->scale_factor, capture->fg,
+                 capture->bg);
+    } else {
+      // Planar Y, U and V
+      const size_t plane_size = (size_t)capture->width * capture->height;
+      for (uint32_t p = 0; p < 3; p++) {
+        render_row(pixels + p * plane_size + y * block_size, 1, row,
+                   capture->window_width, capture->scale_factor,
+                   capture->scale_factor, &capture->fg[p], &capture->bg[p]);
+      }
+    }
+  }
+
+  if (fwrite(capture->buffer, 1, capture->buffer_size, capture->out) !=
+      capture->buffer_size) {
+    fprintf(stderr, "Could not write captured frame\n");
+    return 1;
+  }
+  return 0;
+}
+
+// Up to CAPTURE_STREAM_BUFFER bytes of frames are still buffered here, so a
+// failed flush means a truncated capture
+int close_capture(capture_t *capture) {
+  int ret = 0;
+  if (capture->out == stdout) {
+    ret = fflush(stdout) != 0;
+  } else if (capture->out) {
+    ret = fclose(capture->out) != 0;
+  }
+  if (ret) {
+    fprintf(stderr, "Could not write captured frames\n");
+  }
+  // stdout keeps using its stream buffer until exit
+  if (capture->out != stdout) {
+    free(capture->stream_buffer);
+  }
+  free(capture->buffer);
+  capture->buffer = NULL;
+  capture->stream_buffer = NULL;
+  capture->out = NULL;
+  return ret;
+}
+
+// Emulate without a window and as fast as possible, capturing every frame.
+// frames = 0 captures CAPTURE_DEFAULT_FRAMES, as ROMs never stop on their own.
+// Fails if the machine stopped on an error
+int run_capture(const config_t config, const char *rom_name, const char *path,
+                capture_format_t format, bool changed_only, uint64_t frames) {
+  chip8_t chip8;
+  capture_t capture;
+
+  if (init_chip8(&chip8, rom_name) != 0)
+    return 1;
+
+  if (open_capture(&capture, path, format, changed_only, config) != 0)
+    return 1;
+
+  if (frames == 0) {
+    frames = CAPTURE_DEFAULT_FRAMES;
+  }
+
+  int ret = 0;
+  for (uint64_t frame = 0; chip8.state == RUNNING && frame < frames;
+       frame++) {
+    run_instructions(&chip8, config,
+                     chip8_frame_instructions(&chip8, config.core));
+    if (capture_frame(&capture, &chip8) != 0) {
+      ret = 1;
+      break;
+    }
+  }
+
+  ret |= close_capture(&capture);
+  return ret || chip8.state == QUIT;
+}
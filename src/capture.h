@@ -0,0 +1,42 @@
+#ifndef MY_CAPTURE
+#define MY_CAPTURE
+
+#include <stdio.h>
+
+#include "host.h"
+
+#define CAPTURE_DEFAULT_FRAMES 3600 // One minute
+
+typedef enum {
+  CAPTURE_Y4M, // YUV4MPEG2 4:4:4 video stream
+  CAPTURE_PPM, // Concatenated binary PPM images
+} capture_format_t;
+
+// Headless frame capture, independent of SDL
+typedef struct {
+  FILE *out;
+  capture_format_t format;
+  bool changed_only;     // Skip frames identical to the last captured one
+  bool has_last;         // last_display holds a captured frame
+  bool last_display[64 * 32];
+  uint32_t width;        // Scaled frame size
+  uint32_t height;
+  uint32_t scale_factor;
+  uint32_t window_width; // CHIP8 display size
+  uint32_t window_height;
+  uint8_t fg[3];         // Foreground color, as RGB or YUV
+  uint8_t bg[3];         // Background color, as RGB or YUV
+  uint8_t *buffer;       // Whole frame with its header, reused every frame
+  size_t header_size;
+  size_t buffer_size;
+  char *stream_buffer;   // stdio buffer of out
+} capture_t;
+
+int open_capture(capture_t *capture, const char *path, capture_format_t format,
+                 bool changed_only, const config_t config);
+int capture_frame(capture_t *capture, const chip8_t *chip8);
+int close_capture(capture_t *capture);
+int run_capture(const config_t config, const char *rom_name, const char *path,
+                capture_format_t format, bool changed_only, uint64_t frames);
+
+#endif
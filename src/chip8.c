@@ -1,11 +1,9 @@
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #include "chip8.h"
 
 #ifdef DEBUG
+#include <stdio.h>
 #define debug_print(...) printf(__VA_ARGS__)
 #else
 #define debug_print(...)                                                       \
@@ -13,8 +11,16 @@
   } while (0)
 #endif
 
-int init_chip8(chip8_t *chip8, const char *rom_name) {
-  const uint32_t entrypoint = 0x200;
+#define ENTRYPOINT 0x200
+// Addresses wrap around the 4K of RAM and key numbers around the 16 keys, so
+// that no ROM can make the core access memory outside the machine
+#define ADDR(address) ((address) & 0xFFF)
+#define KEY(key) ((key) & 0xF)
+#define STACK_DEPTH (sizeof((chip8_t *)0)->stack / sizeof(uint16_t))
+
+// A zero seed is replaced by 1, the random number generator needs a non-zero
+// state
+void chip8_reset(chip8_t *chip8, uint32_t seed) {
   const uint8_t font[] = {
       0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
       0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -34,53 +40,64 @@ int init_chip8(chip8_t *chip8, const char *rom_name) {
       0xF0, 0x80, 0xF0, 0x80, 0x80  // F
   };
 
+  memset(chip8, 0, sizeof *chip8);
+
   // Load font (by tradition, put it at 0x50–0x9F)
   memcpy(&chip8->ram[0x50], font, sizeof(font));
 
-  // Seed random number generator
-  srand(time(NULL));
+  // Keeping the random number generator state inside the machine makes a
+  // copy of chip8_t a complete snapshot (used by run-ahead)
+  chip8->rng = seed ? seed : 1;
+
+  chip8->state = RUNNING;
+  chip8->PC = ENTRYPOINT;
+}
 
-  // Open ROM file
-  FILE *rom_file = fopen(rom_name, "rb");
-  if (rom_file == NULL) {
-    fprintf(stderr, "Could not open ROM file %s\n", rom_name);
-    return 1;
+chip8_error_t chip8_load_rom(chip8_t *chip8, const uint8_t *rom,
+                             size_t rom_size) {
+  if (rom_size > sizeof chip8->ram - ENTRYPOINT) {
+    return CHIP8_ERR_ROM_TOO_LARGE;
   }
 
-  // Get ROM size
-  fseek(rom_file, 0, SEEK_END);
-  const size_t rom_size = ftell(rom_file);
-  const size_t max_size = sizeof chip8->ram - entrypoint;
-  rewind(rom_file);
+  memcpy(&chip8->ram[ENTRYPOINT], rom, rom_size);
+  return CHIP8_OK;
+}
 
-  if (rom_size > sizeof(chip8->ram)) {
-    fprintf(stderr, "ROM file %s is too large! Size: %zu. Max size: %zu\n",
-            rom_name, rom_size, max_size);
-    return 1;
-  }
+// Emulated time is split in 60Hz ticks of insts_per_sec / 60 instructions,
+// carrying the fraction over: tick n starts at instruction
+// ceil(n * insts_per_sec / 60). Frames and timers both follow these ticks.
+// A clock rate of 0 stops time
+static uint64_t ticks_at(uint64_t count, const chip8_config_t config) {
+  return config.insts_per_sec ? count * 60 / config.insts_per_sec : 0;
+}
 
-  // Load ROM
-  size_t ret =
-      fread(&chip8->ram[entrypoint], sizeof(uint8_t), rom_size, rom_file);
-  if (ret != rom_size) {
-    fprintf(stderr, "Could not load ROM into RAM\n");
-    return 1;
-  }
-  fclose(rom_file);
+// Instruction count at which the tick after the one containing count starts
+static uint64_t next_tick_at(uint64_t count, const chip8_config_t config) {
+  if (config.insts_per_sec == 0)
+    return UINT64_MAX;
 
-  chip8->state = RUNNING;
-  chip8->PC = entrypoint;
-  return 0;
+  const uint64_t tick = ticks_at(count, config) + 1;
+  return (tick * config.insts_per_sec + 59) / 60;
 }
 
-void emulate_instruction(chip8_t *chip8, const config_t config) {
+// Fire the tick callback whenever emulated time crosses a 60Hz boundary
+static void timer_tick(chip8_t *chip8, const chip8_config_t config) {
+  chip8->next_tick_at = next_tick_at(chip8->inst_count, config);
+  chip8->tick_callback(chip8->tick_userdata,
+                       chip8_get_delay_timer(chip8, config),
+                       chip8_get_sound_timer(chip8, config));
+}
+
+chip8_error_t chip8_emulate_instruction(chip8_t *chip8,
+                                        const chip8_config_t config) {
+  chip8_error_t error = CHIP8_OK;
   instruction_t inst;
-  inst.opcode = (chip8->ram[chip8->PC] << 8) | chip8->ram[chip8->PC + 1];
+  inst.opcode = (chip8->ram[ADDR(chip8->PC)] << 8) |
+                 chip8->ram[ADDR(chip8->PC + 1)];
   chip8->PC += 2; // Pre-increment program counter
+  chip8->inst_count++;
 
-#if DEBUG
-  printf("%04X ", inst.opcode);
-#endif /* ifdef DEBUG */
+  debug_print("%04X ", inst.opcode);
 
   switch (inst.nnn.MSN) {
   case 0x0:
@@ -91,13 +108,14 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     } else if (inst.nnn.NNN == 0xEE) {
       // 0x00EE: return from subrutine
       if (chip8->SP == 0) {
-        printf("Error: trying to pop from empty stack\n");
+        error = CHIP8_ERR_STACK_UNDERFLOW;
+        break;
       }
       chip8->PC = chip8->stack[--chip8->SP];
       debug_print("Return from subroutine. New PC = %d\n", chip8->PC);
     } else {
-      printf("Unimplemented\n");
       // Maybe 0xNNN for calling machine code routine for RCA1802
+      error = CHIP8_ERR_UNIMPLEMENTED;
     }
     break;
   case 0x1:
@@ -108,10 +126,11 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
   case 0x2:
     // 0x2NNN: call subroutine at NNN
     // Push current PC to the stack
-    chip8->stack[chip8->SP++] = chip8->PC;
-    if (chip8->SP > 12) {
-      printf("Error: stack overflow\n");
+    if (chip8->SP >= STACK_DEPTH) {
+      error = CHIP8_ERR_STACK_OVERFLOW;
+      break;
     }
+    chip8->stack[chip8->SP++] = chip8->PC;
     // Jump to NNN
     chip8->PC = inst.nnn.NNN;
     debug_print("Call subrouting at %d\n", chip8->PC);
@@ -257,21 +276,25 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     }
     break;
   case 0xC:
-    chip8->V[inst.xnn.X] = (rand() % 256) & inst.xnn.NN;
+    // 0xCXNN: set VX to a random number AND NN (xorshift32)
+    chip8->rng ^= chip8->rng << 13;
+    chip8->rng ^= chip8->rng >> 17;
+    chip8->rng ^= chip8->rng << 5;
+    chip8->V[inst.xnn.X] = (chip8->rng % 256) & inst.xnn.NN;
     break;
   case 0xD: { // 0xDXYN: draw a sprite
     uint16_t x, y;
     chip8->V[0xF] = 0;
-    y = chip8->V[inst.xyn.Y] % config.window_height;
+    y = chip8->V[inst.xyn.Y] % CHIP8_DISPLAY_HEIGHT;
 
     // Loop over N rows of the sprite
     for (int i = 0; i < inst.xyn.N; i++) {
-      x = chip8->V[inst.xyn.X] % config.window_width;
-      uint8_t byte = chip8->ram[chip8->I + i];
+      x = chip8->V[inst.xyn.X] % CHIP8_DISPLAY_WIDTH;
+      uint8_t byte = chip8->ram[ADDR(chip8->I + i)];
 
       for (int j = 0; j < 8; j++) {
         const bool bit = byte & (1 << (7 - j));
-        bool *pixel = &chip8->display[y * config.window_width + x];
+        bool *pixel = &chip8->display[y * CHIP8_DISPLAY_WIDTH + x];
 
         // If sprite bit and display pixel are on, set carry flag
         if (bit && *pixel) {
@@ -282,11 +305,11 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
         *pixel ^= bit;
 
         // Stop drawing at the right edge of the screen
-        if (++x >= config.window_width)
+        if (++x >= CHIP8_DISPLAY_WIDTH)
           break;
       }
       // Stop drawing at the bottom of the screen
-      if (++y >= config.window_height)
+      if (++y >= CHIP8_DISPLAY_HEIGHT)
         break;
     }
     debug_print("Draw sprite\n");
@@ -296,13 +319,13 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     switch (inst.xnn.NN) {
     case 0x9E:
       // 0xEX9E: skip instruction if key in VX is pressed
-      if (chip8->keypad[chip8->V[inst.xnn.X]]) {
+      if (chip8->keypad[KEY(chip8->V[inst.xnn.X])]) {
         chip8->PC += 2;
       }
       break;
     case 0xA1:
       // 0xEXA1: skip instruction if key in VX is not pressed
-      if (!chip8->keypad[chip8->V[inst.xnn.X]]) {
+      if (!chip8->keypad[KEY(chip8->V[inst.xnn.X])]) {
         chip8->PC += 2;
       }
       break;
@@ -314,7 +337,7 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     switch (inst.xnn.NN) {
     case 0x07:
       // 0xFX07: set VX to the value of the delay timer
-      chip8->V[inst.xnn.X] = chip8->delay;
+      chip8->V[inst.xnn.X] = chip8_get_delay_timer(chip8, config);
       break;
     case 0x0A: {
       // 0xFX0A: wait for key press then store it in VX
@@ -335,10 +358,12 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     case 0x15:
       // 0xFX15: set the delay timer to VX
       chip8->delay = chip8->V[inst.xnn.X];
+      chip8->delay_set_at = chip8->inst_count;
       break;
     case 0x18:
       // 0xFX18: set the sound timer to VX
       chip8->sound = chip8->V[inst.xnn.X];
+      chip8->sound_set_at = chip8->inst_count;
       break;
     case 0x1E:
       // 0xFX1E: add VX to I (carry flag VF is not affected)
@@ -352,24 +377,24 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     case 0x33: {
       // 0xFX33:
       uint8_t bcd = chip8->V[inst.xnn.X];
-      chip8->ram[chip8->I + 2] = bcd % 10;
+      chip8->ram[ADDR(chip8->I + 2)] = bcd % 10;
       bcd /= 10;
-      chip8->ram[chip8->I + 1] = bcd % 10;
+      chip8->ram[ADDR(chip8->I + 1)] = bcd % 10;
       bcd /= 10;
-      chip8->ram[chip8->I] = bcd % 10;
+      chip8->ram[ADDR(chip8->I)] = bcd % 10;
       break;
     }
     case 0x55:
       // 0xFX55: store from V0 to VX (included) in memory, starting at address I
       for (uint8_t i = 0; i <= inst.xnn.X; i++) {
-        chip8->ram[chip8->I + i] = chip8->V[i];
+        chip8->ram[ADDR(chip8->I + i)] = chip8->V[i];
       }
       break;
     case 0x65:
       // 0xFX65: fill from V0 to VX (included) with values from memory, starting
       // at address I
       for (uint8_t i = 0; i <= inst.xnn.X; i++) {
-        chip8->V[i] = chip8->ram[chip8->I + i];
+        chip8->V[i] = chip8->ram[ADDR(chip8->I + i)];
       }
       break;
     default:
@@ -377,7 +402,97 @@ void emulate_instruction(chip8_t *chip8, const config_t config) {
     }
     break;
   default:
-    printf("Unimplemented\n");
+    error = CHIP8_ERR_UNIMPLEMENTED;
     break; // Unimplemented or invalid opcode
   }
+
+  if (chip8->tick_callback && chip8->inst_count >= chip8->next_tick_at) {
+    timer_tick(chip8, config);
+  }
+
+  return error;
+}
+
+// Stops at the first error
+chip8_error_t chip8_emulate_instructions(chip8_t *chip8,
+                                         const chip8_config_t config,
+                                         uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    const chip8_error_t error = chip8_emulate_instruction(chip8, config);
+    if (error != CHIP8_OK)
+      return error;
+  }
+  return CHIP8_OK;
+}
+
+// Instructions left until the next 60Hz tick, i.e. the length of the frame
+// starting now
+uint32_t chip8_frame_instructions(const chip8_t *chip8,
+                                  const chip8_config_t config) {
+  if (config.insts_per_sec == 0)
+    return 0;
+  return next_tick_at(chip8->inst_count, config) - chip8->inst_count;
+}
+
+chip8_error_t chip8_emulate_frame(chip8_t *chip8, const chip8_config_t config) {
+  return chip8_emulate_instructions(chip8, config,
+                                    chip8_frame_instructions(chip8, config));
+}
+
+const bool *chip8_get_display(const chip8_t *chip8) { return chip8->display; }
+
+void chip8_press_key(chip8_t *chip8, uint8_t key) {
+  chip8->keypad[KEY(key)] = true;
+}
+
+void chip8_release_key(chip8_t *chip8, uint8_t key) {
+  chip8->keypad[KEY(key)] = false;
+}
+
+// The callback is stored in the machine: clear it on snapshots that should
+// not report ticks
+void chip8_set_tick_callback(chip8_t *chip8, const chip8_config_t config,
+                             chip8_tick_callback_t callback, void *userdata) {
+  chip8->tick_callback = callback;
+  chip8->tick_userdata = userdata;
+  chip8->next_tick_at = next_tick_at(chip8->inst_count, config);
+}
+
+// Timers count down on every 60Hz tick of emulated time. Instead of
+// decrementing them every frame, derive their current value from the ticks
+// that started since they were last set.
+static uint8_t timer_value(const chip8_t *chip8, const chip8_config_t config,
+                           uint8_t value, uint64_t set_at) {
+  if (value == 0)
+    return 0;
+
+  const uint64_t ticks =
+      ticks_at(chip8->inst_count, config) - ticks_at(set_at, config);
+  return (ticks >= value) ? 0 : value - ticks;
+}
+
+uint8_t chip8_get_delay_timer(const chip8_t *chip8,
+                              const chip8_config_t config) {
+  return timer_value(chip8, config, chip8->delay, chip8->delay_set_at);
+}
+
+uint8_t chip8_get_sound_timer(const chip8_t *chip8,
+                              const chip8_config_t config) {
+  return timer_value(chip8, config, chip8->sound, chip8->sound_set_at);
+}
+
+const char *chip8_strerror(chip8_error_t error) {
+  switch (error) {
+  case CHIP8_OK:
+    return "no error";
+  case CHIP8_ERR_ROM_TOO_LARGE:
+    return "ROM is too large";
+  case CHIP8_ERR_STACK_OVERFLOW:
+    return "stack overflow";
+  case CHIP8_ERR_STACK_UNDERFLOW:
+    return "trying to pop from empty stack";
+  case CHIP8_ERR_UNIMPLEMENTED:
+    return "unimplemented instruction";
+  }
+  return "unknown error";
 }
@@ -1,23 +1,32 @@
 #ifndef MY_CHIP8
 #define MY_CHIP8
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
-// Emulator configuration
+// CHIP8 display resolution, fixed whatever the window size
+#define CHIP8_DISPLAY_WIDTH 64
+#define CHIP8_DISPLAY_HEIGHT 32
+
+// Settings read by the core: quirks and clock rate
 typedef struct {
-  uint32_t window_width;
-  uint32_t window_height;
-  uint32_t scale_factor;
-  uint32_t fg_color;
-  uint32_t bg_color;
-  bool pixel_outline;     // Draw outline around active pixels
   bool shift_VX_only;     // CHIP-48 and SUPER-CHIP behavior in bit shifting
   bool use_BXNN;          // Replace BXNN with BNNN for CHIP-48 and SUPER-CHIP
   uint32_t insts_per_sec; // Clock rate
-  uint32_t square_wave_freq;  // Frequency of square wave for audio
-  uint32_t audio_sample_rate; // Audio sample rate
-  uint16_t volume;            // Audio volume
-} config_t;
+} chip8_config_t;
+
+// Errors returned by the core instead of printing
+typedef enum {
+  CHIP8_OK = 0,
+  CHIP8_ERR_ROM_TOO_LARGE,
+  CHIP8_ERR_STACK_OVERFLOW,
+  CHIP8_ERR_STACK_UNDERFLOW,
+  CHIP8_ERR_UNIMPLEMENTED,
+} chip8_error_t;
+
+// Called on every 60Hz timer tick with the current timer values
+typedef void (*chip8_tick_callback_t)(void *userdata, uint8_t delay,
+                                      uint8_t sound);
 
 // Emulator states
 typedef enum {
@@ -51,18 +60,45 @@ typedef union {
 typedef struct {
   emulator_state_t state;
   uint8_t ram[4096];
-  bool display[64 * 32]; // Default resolution
+  bool display[CHIP8_DISPLAY_WIDTH * CHIP8_DISPLAY_HEIGHT];
   uint16_t stack[12];    // Stack
   uint8_t SP;            // Stack pointer (not a register)
   uint16_t I;            // Index register
   uint16_t PC;           // Program counter
   uint8_t V[16];         // Data registers
-  uint8_t delay;         // Delay timer
-  uint8_t sound;         // Sound timer
+  uint8_t delay;         // Delay timer value when it was last set
+  uint8_t sound;         // Sound timer value when it was last set
+  uint64_t delay_set_at; // Instruction count when delay timer was set
+  uint64_t sound_set_at; // Instruction count when sound timer was set
+  uint64_t inst_count;   // Number of executed instructions
   bool keypad[16];       // Hexadecimal keypad
+  uint32_t rng;          // Random number generator state (CXNN)
+  uint64_t next_tick_at; // Instruction count of the next timer tick
+  chip8_tick_callback_t tick_callback; // Optional, copied along with snapshots
+  void *tick_userdata;
 } chip8_t;
 
-int init_chip8(chip8_t *chip8, const char *rom_name);
-void emulate_instruction(chip8_t *chip8, const config_t config);
+// Core API: no allocation, no I/O, safe to embed in any host
+void chip8_reset(chip8_t *chip8, uint32_t seed);
+chip8_error_t chip8_load_rom(chip8_t *chip8, const uint8_t *rom,
+                             size_t rom_size);
+chip8_error_t chip8_emulate_instruction(chip8_t *chip8,
+                                        const chip8_config_t config);
+chip8_error_t chip8_emulate_instructions(chip8_t *chip8,
+                                         const chip8_config_t config,
+                                         uint32_t count);
+uint32_t chip8_frame_instructions(const chip8_t *chip8,
+                                  const chip8_config_t config);
+chip8_error_t chip8_emulate_frame(chip8_t *chip8, const chip8_config_t config);
+const bool *chip8_get_display(const chip8_t *chip8);
+void chip8_press_key(chip8_t *chip8, uint8_t key);
+void chip8_release_key(chip8_t *chip8, uint8_t key);
+void chip8_set_tick_callback(chip8_t *chip8, const chip8_config_t config,
+                             chip8_tick_callback_t callback, void *userdata);
+uint8_t chip8_get_delay_timer(const chip8_t *chip8,
+                              const chip8_config_t config);
+uint8_t chip8_get_sound_timer(const chip8_t *chip8,
+                              const chip8_config_t config);
+const char *chip8_strerror(chip8_error_t error);
 
 #endif
@@ -0,0 +1,150 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "graphics.h"
+#include "protocol.h"
+
+// Frames received from the server, to resolve the base of incoming deltas
+typedef struct {
+  uint32_t seq[FRAME_HISTORY];
+  packed_frame_t frames[FRAME_HISTORY];
+} frame_history_t;
+
+static void unpack_display(bool *display, const packed_frame_t frame) {
+  for (uint32_t i = 0; i < FRAME_ROWS * FRAME_ROW_BYTES * 8; i++) {
+    display[i] = (frame[i / 64][(i % 64) / 8] >> (7 - i % 8)) & 1;
+  }
+}
+
+static bool send_ack(int fd, uint32_t seq) {
+  const ack_msg_t msg = {.type = MSG_ACK, .seq = seq};
+  return send(fd, &msg, sizeof msg, MSG_NOSIGNAL) == sizeof msg;
+}
+
+// Apply a delta on top of its base frame and acknowledge it. Returns false
+// if the base is unknown or the message is truncated, in which case the
+// frame is dropped and the server restarts from blank
+static bool apply_frame(int fd, frame_history_t *history,
+                        const frame_msg_t *msg, size_t size, bool *display) {
+  static const packed_frame_t blank = {{0}};
+  const uint8_t(*base)[FRAME_ROW_BYTES] = NULL;
+
+  if (msg->base == 0) {
+    base = blank;
+  } else if (history->seq[msg->base % FRAME_HISTORY] == msg->base) {
+    base = history->frames[msg->base % FRAME_HISTORY];
+  } else {
+    send_ack(fd, 0);
+    return false;
+  }
+
+  packed_frame_t frame;
+  memcpy(frame, base, sizeof frame);
+
+  uint32_t changed = 0;
+  for (uint32_t y = 0; y < FRAME_ROWS; y++) {
+    if (!(msg->rows & (1u << y)))
+      continue;
+    if (FRAME_MSG_SIZE(changed + 1) > size) {
+      // Never acknowledge a frame that was not fully rebuilt: the server
+      // would use it as the base of the next deltas
+      send_ack(fd, 0);
+      return false;
+    }
+    for (uint32_t b = 0; b < FRAME_ROW_BYTES; b++) {
+      frame[y][b] ^= msg->data[changed][b];
+    }
+    changed++;
+  }
+
+  history->seq[msg->seq % FRAME_HISTORY] = msg->seq;
+  memcpy(history->frames[msg->seq % FRAME_HISTORY], frame, sizeof frame);
+  unpack_display(display, frame);
+  send_ack(fd, msg->seq);
+  return true;
+}
+
+// Render a session served by run_server, forwarding keypad changes to it
+int run_client(config_t config, const char *socket_path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof addr.sun_path) {
+    fprintf(stderr, "Socket path %s is too long\n", socket_path);
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  const int fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) != 0) {
+    fprintf(stderr, "Could not connect to %s: %s\n", socket_path,
+            strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  sdl_t sdl = {0};
+  if (init_sdl(&sdl, &config) != 0) {
+    close(fd);
+    return 1;
+  }
+  clear_screen(sdl, config);
+
+  // Only the keypad, state and display of the local machine are used: the
+  // server owns the emulation, so pausing has no effect
+  static chip8_t chip8;
+  static frame_history_t history;
+  bool sent_keypad[16] = {0};
+  chip8.state = RUNNING;
+
+  int ret = 0;
+  while (chip8.state != QUIT) {
+    handle_input(&chip8, NULL);
+    for (uint8_t key = 0; key < 16; key++) {
+      if (chip8.keypad[key] != sent_keypad[key]) {
+        const key_msg_t msg = {
+            .type = MSG_KEY, .key = key, .down = chip8.keypad[key]};
+        send(fd, &msg, sizeof msg, MSG_NOSIGNAL);
+        sent_keypad[key] = chip8.keypad[key];
+      }
+    }
+
+    // Wait a little for the next messages, then handle all pending ones
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, 4) < 0 && errno != EINTR)
+      break;
+
+    bool updated = false;
+    frame_msg_t msg;
+    ssize_t size;
+    while ((size = recv(fd, &msg, sizeof msg, MSG_DONTWAIT)) > 0) {
+      if (msg.type == MSG_FRAME && size >= (ssize_t)FRAME_MSG_SIZE(0)) {
+        updated |= apply_frame(fd, &history, &msg, size, chip8.display);
+      } else if (msg.type == MSG_SOUND &&
+                 size >= (ssize_t)sizeof(sound_msg_t)) {
+        sound_msg_t sound;
+        memcpy(&sound, &msg, sizeof sound);
+        set_audio_voices(sdl, sound.on);
+      }
+    }
+    if (size == 0 || (size < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                      errno != EINTR)) {
+      fprintf(stderr, "Server closed the connection\n");
+      ret = 1;
+      break;
+    }
+
+    if (updated) {
+      update_screen(sdl, config, chip8);
+    }
+  }
+
+  quit_sdl(sdl);
+  close(fd);
+  return ret;
+}
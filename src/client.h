@@ -0,0 +1,8 @@
+#ifndef MY_CLIENT
+#define MY_CLIENT
+
+#include "host.h"
+
+int run_client(config_t config, const char *socket_path);
+
+#endif
@@ -1,21 +1,68 @@
+#include <math.h>
+
 #include "graphics.h"
 #include "chip8.h"
 
+// Runs on the audio thread: only touches the audio engine, never the config
+// or the emulator state
 void audio_callback(void *userdata, uint8_t *audiodata, int len) {
-  config_t *config = (config_t *)userdata;
+  audio_t *audio = (audio_t *)userdata;
 
   int16_t *stream = (int16_t *)audiodata;
-  static uint32_t running_sample_index = 0;
-  const int32_t square_wave_period =
-      config->audio_sample_rate / config->square_wave_freq;
-  const int32_t half_square_wave_period = square_wave_period / 2;
+  const int32_t target =
+      atomic_load_explicit(&audio->target_gain, memory_order_relaxed);
+  uint32_t phase = audio->phase;
+  int32_t gain = audio->gain;
 
   // Len is in bytes. We're filling in 2 bytes at the time (int16_t)
   for (int i = 0; i < (len / 2); i++) {
-    stream[i] = ((running_sample_index++ / half_square_wave_period) % 2)
-                    ? config->volume
-                    : -config->volume;
+    // Ramp the gain towards the target to avoid clicks
+    if (gain < target) {
+      gain = SDL_min(gain + audio->gain_step, target);
+    } else if (gain > target) {
+      gain = SDL_max(gain - audio->gain_step, target);
+    }
+
+    const int32_t sample = audio->wave[phase >> (32 - WAVE_TABLE_BITS)];
+    stream[i] = (sample * gain) >> 16;
+    phase += audio->phase_step;
   }
+
+  audio->phase = phase;
+  audio->gain = gain;
+}
+
+// Precompute one period of a square wave as a sum of its odd harmonics,
+// keeping only those below the Nyquist frequency so that the tone does not
+// alias
+// Fails on a config that would leave the wave table or phase step undefined
+static int init_audio(audio_t *audio, const config_t *config) {
+  if (config->square_wave_freq == 0 || config->audio_sample_rate == 0) {
+    fprintf(stderr, "Invalid audio config: %u Hz tone at %u samples/s\n",
+            config->square_wave_freq, config->audio_sample_rate);
+    return 1;
+  }
+
+  const double pi = 3.14159265358979323846;
+  const uint32_t nyquist = config->audio_sample_rate / 2;
+
+  for (uint32_t i = 0; i < WAVE_TABLE_SIZE; i++) {
+    const double t = 2 * pi * i / WAVE_TABLE_SIZE;
+    double sample = 0;
+    for (uint32_t k = 1; k * config->square_wave_freq < nyquist; k += 2) {
+      sample += sin(k * t) / k;
+    }
+    audio->wave[i] = (int16_t)(config->volume * 4 / pi * sample);
+  }
+
+  audio->phase = 0;
+  audio->phase_step = ((uint64_t)config->square_wave_freq << 32) /
+                      config->audio_sample_rate;
+  audio->gain = 0;
+  audio->gain_step =
+      GAIN_ONE / SDL_max(config->audio_sample_rate * ENVELOPE_MS / 1000, 1);
+  atomic_init(&audio->target_gain, 0);
+  return 0;
 }
 
 int init_sdl(sdl_t *sdl, config_t *config) {
@@ -40,13 +87,22 @@ int init_sdl(sdl_t *sdl, config_t *config) {
   }
 
   // Init audio
+  sdl->audio = calloc(1, sizeof(audio_t));
+  if (sdl->audio == NULL) {
+    fprintf(stderr, "Could not allocate audio engine\n");
+    return 1;
+  }
+  if (init_audio(sdl->audio, config) != 0) {
+    return 1;
+  }
+
   sdl->desired = (SDL_AudioSpec){
       .freq = config->audio_sample_rate,
       .format = AUDIO_S16LSB,
       .channels = 1,
       .samples = 512,
       .callback = audio_callback,
-      .userdata = config,
+      .userdata = sdl->audio,
   };
 
   sdl->dev = SDL_OpenAudioDevice(NULL, 0, &sdl->desired, &sdl->obtained, 0);
@@ -61,6 +117,9 @@ int init_sdl(sdl_t *sdl, config_t *config) {
     return 1;
   }
 
+  // The device plays continuously; silence is produced by the envelope
+  SDL_PauseAudioDevice(sdl->dev, 0);
+
   return 0;
 }
 
@@ -92,8 +151,8 @@ void update_screen(const sdl_t sdl, const config_t config,
 
   // Loop through display pixels
   for (uint32_t i = 0; i < sizeof chip8.display; i++) {
-    rect.x = (i % config.window_width) * config.scale_factor;
-    rect.y = (i / config.window_width) * config.scale_factor;
+    rect.x = (i % CHIP8_DISPLAY_WIDTH) * config.scale_factor;
+    rect.y = (i / CHIP8_DISPLAY_WIDTH) * config.scale_factor;
 
     if (chip8.display[i]) {
       SDL_SetRenderDrawColor(sdl.renderer, fg_r, fg_g, fg_b, fg_a);
@@ -112,22 +171,21 @@ void update_screen(const sdl_t sdl, const config_t config,
   SDL_RenderPresent(sdl.renderer);
 }
 
-void update_timers(const sdl_t sdl, chip8_t *chip8) {
-  if (chip8->delay > 0) {
-    chip8->delay--;
-  }
+// Mix the tone of the `sounding` machines sharing the device. They all play
+// the same in-phase tone, so any number of them sounds like one at full gain
+void set_audio_voices(const sdl_t sdl, uint32_t sounding) {
+  atomic_store_explicit(&sdl.audio->target_gain, sounding ? GAIN_ONE : 0,
+                        memory_order_relaxed);
+}
 
-  if (chip8->sound > 0) {
-    chip8->sound--;
-    // TODO: play audio
-    SDL_PauseAudioDevice(sdl.dev, 0); // play sound
-  } else {
-    // TODO: stop playing audio
-    SDL_PauseAudioDevice(sdl.dev, 1); // pause sound
-  }
+void update_audio(const sdl_t sdl, const config_t config,
+                  const chip8_t *chip8) {
+  set_audio_voices(sdl, chip8_get_sound_timer(chip8, config.core) > 0);
 }
 
 int quit_sdl(const sdl_t sdl) {
+  SDL_CloseAudioDevice(sdl.dev);
+  free(sdl.audio);
   SDL_DestroyRenderer(sdl.renderer);
   SDL_DestroyWindow(sdl.window);
   SDL_Quit();
@@ -135,12 +193,82 @@ int quit_sdl(const sdl_t sdl) {
   return 0;
 }
 
+// Called right after a frame has been presented
+void latency_presented(latency_t *latency) {
+  if (!latency->pending)
+    return;
+
+  const uint32_t sample = SDL_GetTicks() - latency->pressed;
+  latency->min = (latency->count == 0) ? sample : SDL_min(latency->min, sample);
+  latency->max = SDL_max(latency->max, sample);
+  latency->total += sample;
+  latency->count++;
+  latency->pending = false;
+}
+
+void latency_report(const latency_t *latency) {
+  if (latency->count == 0) {
+    puts("Input latency: no key presses measured");
+    return;
+  }
+
+  printf("Input latency over %u key presses: min %u ms, avg %.1f ms, "
+         "max %u ms\n",
+         latency->count, latency->min, (double)latency->total / latency->count,
+         latency->max);
+}
+
 // Chip8 keypad     QWERTY
 // 123C             1234
 // 456D             QWER
 // 789E             ASDF
 // A0BF             ZXCV
-void handle_input(chip8_t *chip8) {
+// Returns the keypad key mapped to a keyboard key, or -1 if there is none
+int keypad_key(SDL_Keycode key) {
+  switch (key) {
+  case SDLK_1:
+    return 0x1;
+  case SDLK_2:
+    return 0x2;
+  case SDLK_3:
+    return 0x3;
+  case SDLK_4:
+    return 0xC;
+
+  case SDLK_q:
+    return 0x4;
+  case SDLK_w:
+    return 0x5;
+  case SDLK_e:
+    return 0x6;
+  case SDLK_r:
+    return 0xD;
+
+  case SDLK_a:
+    return 0x7;
+  case SDLK_s:
+    return 0x8;
+  case SDLK_d:
+    return 0x9;
+  case SDLK_f:
+    return 0xE;
+
+  case SDLK_z:
+    return 0xA;
+  case SDLK_x:
+    return 0x0;
+  case SDLK_c:
+    return 0xB;
+  case SDLK_v:
+    return 0xF;
+
+  default:
+    return -1;
+  }
+}
+
+// latency may be NULL when input latency is not measured
+void handle_input(chip8_t *chip8, latency_t *latency) {
   SDL_Event event;
 
   while (SDL_PollEvent(&event)) {
@@ -163,118 +291,30 @@ void handle_input(chip8_t *chip8) {
         }
         break;
 
-      case SDLK_1:
-        chip8->keypad[0x1] = true;
-        break;
-      case SDLK_2:
-        chip8->keypad[0x2] = true;
-        break;
-      case SDLK_3:
-        chip8->keypad[0x3] = true;
-        break;
-      case SDLK_4:
-        chip8->keypad[0xC] = true;
-        break;
+      default: {
+        const int key = keypad_key(event.key.keysym.sym);
+        if (key < 0)
+          break;
 
-      case SDLK_q:
-        chip8->keypad[0x4] = true;
-        break;
-      case SDLK_w:
-        chip8->keypad[0x5] = true;
-        break;
-      case SDLK_e:
-        chip8->keypad[0x6] = true;
-        break;
-      case SDLK_r:
-        chip8->keypad[0xD] = true;
-        break;
-
-      case SDLK_a:
-        chip8->keypad[0x7] = true;
-        break;
-      case SDLK_s:
-        chip8->keypad[0x8] = true;
-        break;
-      case SDLK_d:
-        chip8->keypad[0x9] = true;
-        break;
-      case SDLK_f:
-        chip8->keypad[0xE] = true;
-        break;
-
-      case SDLK_z:
-        chip8->keypad[0xA] = true;
-        break;
-      case SDLK_x:
-        chip8->keypad[0x0] = true;
-        break;
-      case SDLK_c:
-        chip8->keypad[0xB] = true;
-        break;
-      case SDLK_v:
-        chip8->keypad[0xF] = true;
-        break;
+        chip8->keypad[key] = true;
 
-      default:
+        // Remember when the oldest unpresented key press happened
+        if (latency && !latency->pending && !event.key.repeat) {
+          latency->pending = true;
+          latency->pressed = event.key.timestamp;
+        }
         break;
       }
+      }
       break;
 
-    case SDL_KEYUP:
-      switch (event.key.keysym.sym) {
-      case SDLK_1:
-        chip8->keypad[0x1] = false;
-        break;
-      case SDLK_2:
-        chip8->keypad[0x2] = false;
-        break;
-      case SDLK_3:
-        chip8->keypad[0x3] = false;
-        break;
-      case SDLK_4:
-        chip8->keypad[0xC] = false;
-        break;
-
-      case SDLK_q:
-        chip8->keypad[0x4] = false;
-        break;
-      case SDLK_w:
-        chip8->keypad[0x5] = false;
-        break;
-      case SDLK_e:
-        chip8->keypad[0x6] = false;
-        break;
-      case SDLK_r:
-        chip8->keypad[0xD] = false;
-        break;
-
-      case SDLK_a:
-        chip8->keypad[0x7] = false;
-        break;
-      case SDLK_s:
-        chip8->keypad[0x8] = false;
-        break;
-      case SDLK_d:
-        chip8->keypad[0x9] = false;
-        break;
-      case SDLK_f:
-        chip8->keypad[0xE] = false;
-        break;
-
-      case SDLK_z:
-        chip8->keypad[0xA] = false;
-        break;
-      case SDLK_x:
-        chip8->keypad[0x0] = false;
-        break;
-      case SDLK_c:
-        chip8->keypad[0xB] = false;
-        break;
-      case SDLK_v:
-        chip8->keypad[0xF] = false;
-        break;
+    case SDL_KEYUP: {
+      const int key = keypad_key(event.key.keysym.sym);
+      if (key >= 0) {
+        chip8->keypad[key] = false;
       }
       break;
+    }
 
     default:
       break;
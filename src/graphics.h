@@ -2,8 +2,24 @@
 #define MY_GRAPHICS
 
 #include <SDL2/SDL.h>
+#include <stdatomic.h>
 
-#include "chip8.h"
+#include "host.h"
+
+#define WAVE_TABLE_BITS 10
+#define WAVE_TABLE_SIZE (1 << WAVE_TABLE_BITS)
+#define ENVELOPE_MS 5 // Attack and release time of the tone
+#define GAIN_ONE (1 << 16)
+
+// Audio engine, shared between the emulation thread and the audio callback
+typedef struct {
+  int16_t wave[WAVE_TABLE_SIZE]; // One period of band-limited square wave
+  uint32_t phase;                // Phase accumulator (full period = 2^32)
+  uint32_t phase_step;           // Phase increment per sample
+  int32_t gain;                  // Current envelope gain (GAIN_ONE = full)
+  int32_t gain_step;             // Envelope gain change per sample
+  atomic_int target_gain;        // Set by the emulation thread only
+} audio_t;
 
 // SDL Container
 typedef struct {
@@ -12,13 +28,29 @@ typedef struct {
   SDL_AudioSpec desired;
   SDL_AudioSpec obtained;
   SDL_AudioDeviceID dev;
+  audio_t *audio;
 } sdl_t;
 
+// Input-to-present latency statistics (milliseconds)
+typedef struct {
+  bool pending;      // A key press has not been presented yet
+  uint32_t pressed;  // Timestamp of the oldest pending key press
+  uint32_t count;
+  uint32_t total;
+  uint32_t min;
+  uint32_t max;
+} latency_t;
+
 int init_sdl(sdl_t *sdl, config_t *config);
 void clear_screen(const sdl_t sdl, const config_t config);
 void update_screen(const sdl_t sdl, const config_t config, const chip8_t chip8);
-void update_timers(const sdl_t sdl, chip8_t *chip8);
-void handle_input(chip8_t *chip8);
+void set_audio_voices(const sdl_t sdl, uint32_t sounding);
+void update_audio(const sdl_t sdl, const config_t config,
+                  const chip8_t *chip8);
+int keypad_key(SDL_Keycode key);
+void handle_input(chip8_t *chip8, latency_t *latency);
+void latency_presented(latency_t *latency);
+void latency_report(const latency_t *latency);
 int quit_sdl(const sdl_t sdl);
 
 #endif
@@ -0,0 +1,127 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "capture.h"
+#include "chip8.h"
+#include "host.h"
+#include "server.h"
+#include "trace.h"
+
+// Front end without SDL, linked only against libchip8, for headless boxes
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s -c <file> [options] <rom_file>\n"
+          "       %s -T <mode> [options] <rom_file> [rom_file...]\n"
+          "       %s -s <socket> <rom_file>\n"
+          "  -c <file>  capture frames to file ('-' for stdout)\n"
+          "  -f <fmt>   capture format: y4m (default) or ppm\n"
+          "  -C         capture changed frames only\n"
+          "  -n <count> capture or record count frames (default %d and %d),\n"
+          "             verify replays as many frames as were recorded\n"
+          "  -T <mode>  record or verify the <rom_file>.trace golden traces\n"
+          "  -j <jobs>  number of ROMs traced in parallel\n"
+          "  -s <path>  serve sessions of the ROM on a Unix domain socket\n",
+          name, name, name, CAPTURE_DEFAULT_FRAMES, TRACE_DEFAULT_FRAMES);
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[]) {
+  const char *capture_path = NULL;
+  capture_format_t capture_format = CAPTURE_Y4M;
+  bool capture_changed = false;
+  uint64_t frames = 0;
+  const char *trace_mode = NULL;
+  uint32_t trace_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  const char *server_path = NULL;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:f:Cn:T:j:s:")) != -1) {
+    switch (opt) {
+    case 'c':
+      capture_path = optarg;
+      break;
+    case 'f':
+      if (strcmp(optarg, "y4m") == 0) {
+        capture_format = CAPTURE_Y4M;
+      } else if (strcmp(optarg, "ppm") == 0) {
+        capture_format = CAPTURE_PPM;
+      } else {
+        usage(argv[0]);
+      }
+      break;
+    case 'C':
+      capture_changed = true;
+      break;
+    case 'n': {
+      // Traces store the frame count on 32 bits
+      char *end;
+      frames = strtoull(optarg, &end, 10);
+      if (*optarg == '\0' || *end != '\0' || frames > UINT32_MAX) {
+        fprintf(stderr, "Invalid frame count %s\n", optarg);
+        usage(argv[0]);
+      }
+      break;
+    }
+    case 'T':
+      if (strcmp(optarg, "record") != 0 && strcmp(optarg, "verify") != 0) {
+        usage(argv[0]);
+      }
+      trace_mode = optarg;
+      break;
+    case 'j':
+      trace_jobs = strtoul(optarg, NULL, 10);
+      break;
+    case 's':
+      server_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  const int rom_count = argc - optind;
+  // Exactly one of capture, trace or server mode
+  const int modes =
+      (capture_path != NULL) + (trace_mode != NULL) + (server_path != NULL);
+  if (rom_count < 1 || modes != 1) {
+    usage(argv[0]);
+  }
+  // Verify replays the frame count stored in each trace
+  if (frames && trace_mode && strcmp(trace_mode, "verify") == 0) {
+    fprintf(stderr, "-n can not be used with -T verify\n");
+    usage(argv[0]);
+  }
+
+  const config_t config = default_config();
+
+  // Server, one session of the ROM per client, running until interrupted
+  if (server_path) {
+    if (rom_count != 1 || frames) {
+      usage(argv[0]);
+    }
+    exit(run_server(config, argv[optind], server_path) ? EXIT_FAILURE
+                                                       : EXIT_SUCCESS);
+  }
+
+  // Golden trace regression run over all the ROMs
+  if (trace_mode) {
+    exit(run_traces(config,
+                    strcmp(trace_mode, "record") == 0 ? TRACE_RECORD
+                                                      : TRACE_VERIFY,
+                    rom_count, &argv[optind],
+                    frames ? frames : TRACE_DEFAULT_FRAMES, trace_jobs)
+             ? EXIT_FAILURE
+             : EXIT_SUCCESS);
+  }
+
+  if (rom_count != 1) {
+    usage(argv[0]);
+  }
+  exit(run_capture(config, argv[optind], capture_path, capture_format,
+                   capture_changed, frames)
+           ? EXIT_FAILURE
+           : EXIT_SUCCESS);
+}
@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "host.h"
+
+// Emulator configuration used by every front end
+config_t default_config(void) {
+  return (config_t){
+      .window_width = CHIP8_DISPLAY_WIDTH,
+      .window_height = CHIP8_DISPLAY_HEIGHT,
+      .scale_factor = 20,
+      .fg_color = 0xFFFFFFFF,
+      .bg_color = 0x000000FF,
+      .pixel_outline = true,
+      .core =
+          {
+              .shift_VX_only = false,
+              .use_BXNN = false,
+              .insts_per_sec = 500,
+          },
+      .square_wave_freq = 440, // middle A
+      .audio_sample_rate = 44100,
+      .volume = 3000,
+      .input_slices = 4,
+      .run_ahead = false,
+      .measure_latency = false,
+  };
+}
+
+int init_chip8(chip8_t *chip8, const char *rom_name) {
+  chip8_reset(chip8, (uint32_t)time(NULL));
+  return load_rom_file(chip8, rom_name);
+}
+
+int load_rom_file(chip8_t *chip8, const char *rom_name) {
+  uint8_t rom[sizeof chip8->ram];
+
+  // Open ROM file
+  FILE *rom_file = fopen(rom_name, "rb");
+  if (rom_file == NULL) {
+    fprintf(stderr, "Could not open ROM file %s\n", rom_name);
+    return 1;
+  }
+
+  // Read up to the size of RAM, more than fits after the entrypoint, so that
+  // ROMs that are too large get detected
+  const size_t rom_size = fread(rom, sizeof(uint8_t), sizeof rom, rom_file);
+  if (ferror(rom_file)) {
+    fprintf(stderr, "Could not load ROM into RAM\n");
+    fclose(rom_file);
+    return 1;
+  }
+  fclose(rom_file);
+
+  if (chip8_load_rom(chip8, rom, rom_size) != CHIP8_OK) {
+    fprintf(stderr, "ROM file %s is too large! Max size: %zu\n", rom_name,
+            sizeof chip8->ram - 0x200);
+    return 1;
+  }
+
+  return 0;
+}
+
+// Print an error returned by the core to out. Stack errors leave the program
+// in an unrecoverable state and stop the machine. Returns true if it keeps
+// running
+bool handle_error(chip8_t *chip8, chip8_error_t error, FILE *out) {
+  if (error == CHIP8_OK)
+    return true;
+
+  const uint16_t pc = (chip8->PC - 2) & 0xFFF;
+  fprintf(out, "Error at 0x%03X (%02X%02X): %s\n", pc, chip8->ram[pc],
+          chip8->ram[(pc + 1) & 0xFFF], chip8_strerror(error));
+
+  if (error == CHIP8_ERR_UNIMPLEMENTED)
+    return true;
+
+  chip8->state = QUIT;
+  return false;
+}
+
+// Emulate count instructions, carrying on after non-fatal errors
+void run_instructions(chip8_t *chip8, const config_t config, uint32_t count) {
+  while (chip8->state == RUNNING && count > 0) {
+    const uint64_t before = chip8->inst_count;
+    handle_error(chip8, chip8_emulate_instructions(chip8, config.core, count),
+                 stderr);
+    count -= chip8->inst_count - before;
+  }
+}
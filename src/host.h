@@ -0,0 +1,32 @@
+#ifndef MY_HOST
+#define MY_HOST
+
+#include <stdio.h>
+
+#include "chip8.h"
+
+// Emulator configuration
+typedef struct {
+  uint32_t window_width;  // Window size in CHIP8 pixels
+  uint32_t window_height;
+  uint32_t scale_factor;
+  uint32_t fg_color;
+  uint32_t bg_color;
+  bool pixel_outline;         // Draw outline around active pixels
+  chip8_config_t core;        // Quirks and clock rate, passed to the core
+  uint32_t square_wave_freq;  // Frequency of square wave for audio
+  uint32_t audio_sample_rate; // Audio sample rate
+  uint16_t volume;            // Audio volume
+  uint32_t input_slices;      // Input polls per frame
+  bool run_ahead;             // Present one frame ahead of the emulation
+  bool measure_latency;       // Report input-to-present latency on exit
+} config_t;
+
+// Helpers shared by the front ends, which own all file and console I/O
+config_t default_config(void);
+int init_chip8(chip8_t *chip8, const char *rom_name);
+int load_rom_file(chip8_t *chip8, const char *rom_name);
+bool handle_error(chip8_t *chip8, chip8_error_t error, FILE *out);
+void run_instructions(chip8_t *chip8, const config_t config, uint32_t count);
+
+#endif
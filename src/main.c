@@ -1,31 +1,71 @@
+#include <unistd.h>
+
 #include "chip8.h"
+#include "client.h"
 #include "graphics.h"
+#include "host.h"
+#include "wall.h"
+
+// Sleep until the performance counter reaches deadline
+static void wait_until(uint64_t deadline) {
+  const uint64_t now = SDL_GetPerformanceCounter();
+  if (now < deadline) {
+    SDL_Delay((deadline - now) * 1000 / SDL_GetPerformanceFrequency());
+  }
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [options] <rom_file> [rom_file...]\n"
+          "       %s -S <socket>\n"
+          "  -r         run ahead, presenting the next frame (single ROM)\n"
+          "  -l         report input-to-present latency on exit (single ROM)\n"
+          "  -S <path>  connect to a server and render its session\n",
+          name, name);
+  exit(EXIT_FAILURE);
+}
 
 int main(int argc, char *argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s <rom_file>\n", argv[0]);
-    exit(EXIT_FAILURE);
+  const char *client_path = NULL;
+
+  // Initialize emulator configuration, then apply the options
+  config_t config = default_config();
+
+  int opt;
+  while ((opt = getopt(argc, argv, "rlS:")) != -1) {
+    switch (opt) {
+    case 'r':
+      config.run_ahead = true;
+      break;
+    case 'l':
+      config.measure_latency = true;
+      break;
+    case 'S':
+      client_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+
+  if (optind >= argc && client_path == NULL) {
+    usage(argv[0]);
   }
+  const int rom_count = argc - optind;
+  char **rom_names = &argv[optind];
 
   sdl_t sdl = {0};
-  config_t config = {0};
   chip8_t chip8 = {0};
 
-  // Initialize emulator configuration
-  config = (config_t){
-      .window_width = 64,
-      .window_height = 32,
-      .scale_factor = 20,
-      .fg_color = 0xFFFFFFFF,
-      .bg_color = 0x000000FF,
-      .pixel_outline = true,
-      .shift_VX_only = false,
-      .use_BXNN = false,
-      .insts_per_sec = 500,
-      .square_wave_freq = 440, // middle A
-      .audio_sample_rate = 44100,
-      .volume = 3000,
-  };
+  // The client gets its frames from a server instead of a ROM
+  if (client_path) {
+    exit(run_client(config, client_path) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+
+  // Several ROMs run side by side in one window
+  if (rom_count > 1) {
+    exit(run_wall(config, rom_count, rom_names) ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
 
   // Initialize SDL
   if (init_sdl(&sdl, &config) != 0) {
@@ -33,36 +73,69 @@ int main(int argc, char *argv[]) {
   }
 
   // Initialize Chip8
-  if (init_chip8(&chip8, argv[1]) != 0) {
+  if (init_chip8(&chip8, rom_names[0]) != 0) {
     exit(EXIT_FAILURE);
   }
 
   clear_screen(sdl, config);
 
+  latency_t latency = {0};
+  latency_t *latency_ptr = config.measure_latency ? &latency : NULL;
+
+  const uint64_t frame_ticks = SDL_GetPerformanceFrequency() / 60;
+  const uint32_t slices = config.input_slices ? config.input_slices : 1;
+  uint64_t frame_start = SDL_GetPerformanceCounter();
+
   // Main emulator loop
   while (chip8.state != QUIT) {
-    // Handle user input
-    handle_input(&chip8);
+    // Frames end on the 60Hz ticks the timers count, carrying the fraction of
+    // insts_per_sec / 60 over to the next frame
+    const uint32_t insts_per_frame =
+        chip8_frame_instructions(&chip8, config.core);
 
-    if (chip8.state == PAUSED)
-      continue;
+    // Spread the frame's instructions over slices of the 60Hz frame, polling
+    // input before each one so that key presses take effect within a slice
+    for (uint32_t s = 0; s < slices && chip8.state == RUNNING; s++) {
+      wait_until(frame_start + frame_ticks * s / slices);
+      handle_input(&chip8, latency_ptr);
 
-    const uint64_t start_time = SDL_GetPerformanceCounter();
+      if (chip8.state == RUNNING) {
+        run_instructions(&chip8, config,
+                         insts_per_frame * (s + 1) / slices -
+                             insts_per_frame * s / slices);
+      }
+    }
 
-    // Emulate CHIP8 instructions
-    for (uint32_t i = 0; i < config.insts_per_sec / 60; i++) {
-      emulate_instruction(&chip8, config);
+    if (chip8.state == PAUSED) {
+      SDL_Delay(16);
+      handle_input(&chip8, latency_ptr);
+      frame_start = SDL_GetPerformanceCounter();
+      continue;
     }
 
-    const uint64_t end_time = SDL_GetPerformanceCounter();
-    double time_elapsed = ((double)(end_time - start_time) * 1000) /
-                          SDL_GetPerformanceFrequency();
+    // Present right after emulation. In run-ahead mode, show the frame after
+    // this one, emulated on a throwaway snapshot with the current input
+    if (config.run_ahead) {
+      chip8_t ahead = chip8;
+      chip8_set_tick_callback(&ahead, config.core, NULL, NULL);
+      chip8_emulate_frame(&ahead, config.core);
+      update_screen(sdl, config, ahead);
+    } else {
+      update_screen(sdl, config, chip8);
+    }
+    latency_presented(&latency);
+    update_audio(sdl, config, &chip8);
 
-    // Run at approximately 60Hz
-    SDL_Delay((16.67f > time_elapsed) ? 16.67f - time_elapsed : 0);
+    // Run at approximately 60Hz, without accumulating lag
+    frame_start += frame_ticks;
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (now > frame_start + frame_ticks) {
+      frame_start = now;
+    }
+  }
 
-    update_screen(sdl, config, chip8);
-    update_timers(sdl, &chip8);
+  if (config.measure_latency) {
+    latency_report(&latency);
   }
 
   quit_sdl(sdl);
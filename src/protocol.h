@@ -0,0 +1,54 @@
+#ifndef MY_PROTOCOL
+#define MY_PROTOCOL
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Frame streaming protocol between the server and its clients, over a local
+// SOCK_SEQPACKET socket: every message is one packet, in host byte order.
+//
+// The server sends a frame as the XOR of the display rows that changed since
+// the last frame acknowledged by the client, the base. The client keeps its
+// recent frames, applies the delta to the base and acknowledges the result.
+// Acknowledging sequence number 0 asks for a delta against a blank frame.
+#define FRAME_ROWS 32
+#define FRAME_ROW_BYTES (64 / 8)
+#define FRAME_HISTORY 64 // Frames kept on both sides to resolve bases
+
+typedef uint8_t packed_frame_t[FRAME_ROWS][FRAME_ROW_BYTES];
+
+typedef enum {
+  MSG_KEY = 1, // Client: keypad key pressed or released
+  MSG_ACK,     // Client: frame received
+  MSG_FRAME,   // Server: delta-encoded frame
+  MSG_SOUND,   // Server: sound turned on or off
+} msg_type_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t key;
+  uint8_t down;
+} key_msg_t;
+
+typedef struct {
+  uint8_t type;
+  uint32_t seq;
+} ack_msg_t;
+
+typedef struct {
+  uint8_t type;
+  uint8_t on;
+} sound_msg_t;
+
+typedef struct {
+  uint8_t type;
+  uint32_t seq;  // Sequence number of this frame, starting at 1
+  uint32_t base; // Frame the delta applies to
+  uint32_t rows; // Bit y set: row y is in data, in increasing order
+  uint8_t data[FRAME_ROWS][FRAME_ROW_BYTES]; // Only the changed rows are sent
+} frame_msg_t;
+
+#define FRAME_MSG_SIZE(changed_rows)                                           \
+  (offsetof(frame_msg_t, data) + (changed_rows) * FRAME_ROW_BYTES)
+
+#endif
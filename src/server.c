@@ -0,0 +1,288 @@
+#define _GNU_SOURCE // accept4
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+#include "protocol.h"
+#include "server.h"
+
+// One emulator session per connected client
+typedef struct {
+  int fd;
+  chip8_t chip8;
+  bool sound_on;
+  uint32_t seq;       // Last frame sent
+  uint32_t acked_seq; // Last frame acknowledged by the client
+  packed_frame_t acked;
+  packed_frame_t history[FRAME_HISTORY]; // Sent frames, by seq
+} session_t;
+
+typedef struct {
+  session_t **sessions;
+  uint32_t count;
+  uint32_t capacity;
+} server_t;
+
+static volatile sig_atomic_t stop_server = 0;
+
+static void handle_stop(int signal) {
+  (void)signal;
+  stop_server = 1;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void pack_display(packed_frame_t frame, const bool *display) {
+  memset(frame, 0, sizeof(packed_frame_t));
+  for (uint32_t i = 0; i < FRAME_ROWS * FRAME_ROW_BYTES * 8; i++) {
+    frame[i / 64][(i % 64) / 8] |= display[i] << (7 - i % 8);
+  }
+}
+
+static void add_session(server_t *server, int fd, const chip8_t *rom) {
+  if (server->count == server->capacity) {
+    const uint32_t capacity = server->capacity ? server->capacity * 2 : 16;
+    session_t **grown =
+        realloc(server->sessions, capacity * sizeof(session_t *));
+    if (grown == NULL) {
+      close(fd);
+      return;
+    }
+    server->sessions = grown;
+    server->capacity = capacity;
+  }
+
+  session_t *session = calloc(1, sizeof(session_t));
+  if (session == NULL) {
+    close(fd);
+    return;
+  }
+
+  // Every session starts from the loaded ROM, with its own random seed
+  session->fd = fd;
+  session->chip8 = *rom;
+  session->chip8.rng = ((uint32_t)now_ns() ^ (uint32_t)fd) | 1;
+  server->sessions[server->count++] = session;
+}
+
+static void remove_session(server_t *server, uint32_t index) {
+  close(server->sessions[index]->fd);
+  free(server->sessions[index]);
+  server->sessions[index] = server->sessions[--server->count];
+}
+
+// Handle all pending client messages. Returns false once the client is gone
+static bool receive_messages(session_t *session) {
+  uint8_t packet[64];
+
+  while (true) {
+    const ssize_t size = recv(session->fd, packet, sizeof packet, 0);
+    if (size == 0)
+      return false;
+    if (size < 0)
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+    if (packet[0] == MSG_KEY && size >= (ssize_t)sizeof(key_msg_t)) {
+      const key_msg_t *msg = (const key_msg_t *)packet;
+      if (msg->down) {
+        chip8_press_key(&session->chip8, msg->key);
+      } else {
+        chip8_release_key(&session->chip8, msg->key);
+      }
+    } else if (packet[0] == MSG_ACK && size >= (ssize_t)sizeof(ack_msg_t)) {
+      ack_msg_t msg;
+      memcpy(&msg, packet, sizeof msg);
+
+      if (msg.seq == 0) {
+        // Client lost track of its frames, restart from a blank base
+        session->acked_seq = 0;
+        memset(session->acked, 0, sizeof session->acked);
+      } else if (msg.seq > session->acked_seq && msg.seq <= session->seq &&
+                 session->seq - msg.seq < FRAME_HISTORY) {
+        session->acked_seq = msg.seq;
+        memcpy(session->acked, session->history[msg.seq % FRAME_HISTORY],
+               sizeof session->acked);
+      }
+    }
+  }
+}
+
+// Emulate one frame and send what changed. Returns false on fatal errors
+static bool update_session(session_t *session, const config_t config) {
+  run_instructions(&session->chip8, config,
+                   chip8_frame_instructions(&session->chip8, config.core));
+  if (session->chip8.state == QUIT)
+    return false;
+
+  const bool sound_on =
+      chip8_get_sound_timer(&session->chip8, config.core) > 0;
+  if (sound_on != session->sound_on) {
+    const sound_msg_t msg = {.type = MSG_SOUND, .on = sound_on};
+    if (send(session->fd, &msg, sizeof msg, MSG_NOSIGNAL | MSG_DONTWAIT) ==
+        sizeof msg) {
+      session->sound_on = sound_on;
+    }
+  }
+
+  packed_frame_t frame;
+  pack_display(frame, chip8_get_display(&session->chip8));
+  if (session->seq != 0 &&
+      memcmp(frame, session->history[session->seq % FRAME_HISTORY],
+             sizeof frame) == 0)
+    return true;
+
+  // XOR delta against the acknowledged frame, changed rows only
+  frame_msg_t msg = {
+      .type = MSG_FRAME, .seq = session->seq + 1, .base = session->acked_seq};
+  uint32_t changed = 0;
+  for (uint32_t y = 0; y < FRAME_ROWS; y++) {
+    uint8_t delta[FRAME_ROW_BYTES];
+    bool row_changed = false;
+    for (uint32_t b = 0; b < FRAME_ROW_BYTES; b++) {
+      delta[b] = frame[y][b] ^ session->acked[y][b];
+      row_changed |= delta[b] != 0;
+    }
+    if (row_changed) {
+      msg.rows |= 1u << y;
+      memcpy(msg.data[changed++], delta, FRAME_ROW_BYTES);
+    }
+  }
+
+  // If the client is not keeping up, drop the frame: the next delta is
+  // against the acknowledged frame and carries these changes too
+  if (send(session->fd, &msg, FRAME_MSG_SIZE(changed),
+           MSG_NOSIGNAL | MSG_DONTWAIT) < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+
+  session->seq++;
+  memcpy(session->history[session->seq % FRAME_HISTORY], frame, sizeof frame);
+  return true;
+}
+
+// Run one session of the ROM for every client connecting to the Unix domain
+// socket, without a window, all from a single thread
+int run_server(const config_t config, const char *rom_name,
+               const char *socket_path) {
+  chip8_t rom;
+  if (init_chip8(&rom, rom_name) != 0)
+    return 1;
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof addr.sun_path) {
+    fprintf(stderr, "Socket path %s is too long\n", socket_path);
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  const int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0);
+  if (listener < 0) {
+    perror("socket");
+    return 1;
+  }
+  // Remove a stale socket from a previous run, but never anything else
+  struct stat st;
+  if (lstat(socket_path, &st) == 0) {
+    if (!S_ISSOCK(st.st_mode)) {
+      fprintf(stderr, "%s exists and is not a socket\n", socket_path);
+      close(listener);
+      return 1;
+    }
+    unlink(socket_path);
+  }
+  if (bind(listener, (struct sockaddr *)&addr, sizeof addr) != 0 ||
+      listen(listener, SOMAXCONN) != 0) {
+    fprintf(stderr, "Could not listen on %s: %s\n", socket_path,
+            strerror(errno));
+    close(listener);
+    return 1;
+  }
+  fprintf(stderr, "Serving %s on %s\n", rom_name, socket_path);
+  signal(SIGINT, handle_stop);
+  signal(SIGTERM, handle_stop);
+
+  server_t server = {0};
+  struct pollfd *fds = NULL;
+  uint32_t fds_capacity = 0;
+  const uint64_t frame_ns = 1000000000 / 60;
+  uint64_t next_frame = now_ns();
+
+  int ret = 0;
+  while (!stop_server) {
+    if (fds_capacity < server.count + 1) {
+      fds_capacity = server.capacity + 1;
+      struct pollfd *grown = realloc(fds, fds_capacity * sizeof *fds);
+      if (grown == NULL) {
+        fprintf(stderr, "Could not allocate poll descriptors\n");
+        ret = 1;
+        break;
+      }
+      fds = grown;
+    }
+
+    // Wait for messages until the next frame is due
+    fds[0] = (struct pollfd){.fd = listener, .events = POLLIN};
+    for (uint32_t i = 0; i < server.count; i++) {
+      fds[i + 1] = (struct pollfd){.fd = server.sessions[i]->fd,
+                                   .events = POLLIN};
+    }
+    const uint64_t now = now_ns();
+    const int timeout =
+        (next_frame > now) ? (next_frame - now + 999999) / 1000000 : 0;
+    if (poll(fds, server.count + 1, timeout) < 0 && errno != EINTR) {
+      perror("poll");
+      ret = 1;
+      break;
+    }
+
+    // Sessions are swapped on removal, walk backwards
+    for (uint32_t i = server.count; i-- > 0;) {
+      if (fds[i + 1].revents && !receive_messages(server.sessions[i])) {
+        remove_session(&server, i);
+      }
+    }
+
+    if (fds[0].revents & POLLIN) {
+      int fd;
+      while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        add_session(&server, fd, &rom);
+      }
+    }
+
+    if (now_ns() < next_frame)
+      continue;
+
+    for (uint32_t i = server.count; i-- > 0;) {
+      if (!update_session(server.sessions[i], config)) {
+        remove_session(&server, i);
+      }
+    }
+
+    // Run at approximately 60Hz, without accumulating lag
+    next_frame += frame_ns;
+    if (now_ns() > next_frame + frame_ns) {
+      next_frame = now_ns();
+    }
+  }
+
+  while (server.count > 0) {
+    remove_session(&server, server.count - 1);
+  }
+  free(server.sessions);
+  free(fds);
+  close(listener);
+  unlink(socket_path);
+  return ret;
+}
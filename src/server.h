@@ -0,0 +1,9 @@
+#ifndef MY_SERVER
+#define MY_SERVER
+
+#include "host.h"
+
+int run_server(const config_t config, const char *rom_name,
+               const char *socket_path);
+
+#endif
@@ -0,0 +1,463 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "trace.h"
+
+// Golden traces hold, for every frame, a hash of the display and the
+// register file along with the data it was computed from, so that a
+// divergence can be shown. Each ROM runs with a fixed seed and with the key
+// presses of an optional <rom>.keys input script, one "<frame> <key> down|up"
+// per line in frame order.
+//
+// Trace files store the header and frame fields one after the other,
+// without padding, in little-endian order, so they can be shared between
+// hosts. Frame hashes are computed over that encoding too.
+#define TRACE_MAGIC "CH8TRACE"
+#define TRACE_VERSION 3
+#define TRACE_HEADER_SIZE (8 + 2 * 4 + 2 + 2 * 4)
+#define TRACE_FRAME_SIZE (8 + 2 * 2 + 3 + 12 * 2 + 16 + 64 * 32 / 8)
+#define TRACE_SEED 0xC8C8C8C8
+#define TRACE_NAME_SIZE 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t insts_per_sec;
+  uint8_t shift_VX_only; // Quirks the trace was recorded with
+  uint8_t use_BXNN;
+  uint32_t seed;
+  uint32_t frames;
+} trace_header_t;
+
+typedef struct {
+  uint64_t hash; // Hash of all the following fields
+  uint16_t PC;
+  uint16_t I;
+  uint8_t SP;
+  uint8_t delay;
+  uint8_t sound;
+  uint16_t stack[12];
+  uint8_t V[16];
+  uint8_t display[64 * 32 / 8]; // One bit per pixel
+} trace_frame_t;
+
+typedef struct {
+  uint32_t frame;
+  uint8_t key;
+  bool down;
+} key_event_t;
+
+typedef struct {
+  config_t config;
+  trace_mode_t mode;
+  char **rom_names;
+  uint32_t rom_count;
+  uint32_t frames;
+  atomic_uint next;   // Next ROM to run
+  atomic_uint failed; // Number of ROMs that failed
+  pthread_mutex_t output;
+} trace_run_t;
+
+// 64-bit FNV-1a
+static uint64_t hash_bytes(const uint8_t *data, size_t size) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= data[i];
+    hash *= 0x100000001B3ULL;
+  }
+  return hash;
+}
+
+// Append value to out as size little-endian bytes
+static uint8_t *put_le(uint8_t *out, uint64_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    *out++ = value >> (8 * i);
+  }
+  return out;
+}
+
+static const uint8_t *get_le(const uint8_t *in, uint64_t *value,
+                             size_t size) {
+  *value = 0;
+  for (size_t i = 0; i < size; i++) {
+    *value |= (uint64_t)*in++ << (8 * i);
+  }
+  return in;
+}
+
+static void encode_header(uint8_t out[TRACE_HEADER_SIZE],
+                          const trace_header_t *header) {
+  memcpy(out, header->magic, sizeof header->magic);
+  out += sizeof header->magic;
+  out = put_le(out, header->version, 4);
+  out = put_le(out, header->insts_per_sec, 4);
+  out = put_le(out, header->shift_VX_only, 1);
+  out = put_le(out, header->use_BXNN, 1);
+  out = put_le(out, header->seed, 4);
+  put_le(out, header->frames, 4);
+}
+
+static void decode_header(trace_header_t *header,
+                          const uint8_t in[TRACE_HEADER_SIZE]) {
+  uint64_t value;
+  memcpy(header->magic, in, sizeof header->magic);
+  in += sizeof header->magic;
+  in = get_le(in, &value, 4);
+  header->version = value;
+  in = get_le(in, &value, 4);
+  header->insts_per_sec = value;
+  in = get_le(in, &value, 1);
+  header->shift_VX_only = value;
+  in = get_le(in, &value, 1);
+  header->use_BXNN = value;
+  in = get_le(in, &value, 4);
+  header->seed = value;
+  get_le(in, &value, 4);
+  header->frames = value;
+}
+
+static void encode_frame(uint8_t out[TRACE_FRAME_SIZE],
+                         const trace_frame_t *frame) {
+  out = put_le(out, frame->hash, 8);
+  out = put_le(out, frame->PC, 2);
+  out = put_le(out, frame->I, 2);
+  out = put_le(out, frame->SP, 1);
+  out = put_le(out, frame->delay, 1);
+  out = put_le(out, frame->sound, 1);
+  for (int i = 0; i < 12; i++) {
+    out = put_le(out, frame->stack[i], 2);
+  }
+  memcpy(out, frame->V, sizeof frame->V);
+  out += sizeof frame->V;
+  memcpy(out, frame->display, sizeof frame->display);
+}
+
+static void decode_frame(trace_frame_t *frame,
+                         const uint8_t in[TRACE_FRAME_SIZE]) {
+  uint64_t value;
+  in = get_le(in, &frame->hash, 8);
+  in = get_le(in, &value, 2);
+  frame->PC = value;
+  in = get_le(in, &value, 2);
+  frame->I = value;
+  in = get_le(in, &value, 1);
+  frame->SP = value;
+  in = get_le(in, &value, 1);
+  frame->delay = value;
+  in = get_le(in, &value, 1);
+  frame->sound = value;
+  for (int i = 0; i < 12; i++) {
+    in = get_le(in, &value, 2);
+    frame->stack[i] = value;
+  }
+  memcpy(frame->V, in, sizeof frame->V);
+  in += sizeof frame->V;
+  memcpy(frame->display, in, sizeof frame->display);
+}
+
+static void snapshot_frame(trace_frame_t *frame, const chip8_t *chip8,
+                           const config_t config) {
+  memset(frame, 0, sizeof *frame);
+  frame->PC = chip8->PC;
+  frame->I = chip8->I;
+  frame->SP = chip8->SP;
+  frame->delay = chip8_get_delay_timer(chip8, config.core);
+  frame->sound = chip8_get_sound_timer(chip8, config.core);
+  memcpy(frame->stack, chip8->stack, sizeof frame->stack);
+  memcpy(frame->V, chip8->V, sizeof frame->V);
+
+  const bool *display = chip8_get_display(chip8);
+  for (size_t i = 0; i < sizeof chip8->display; i++) {
+    frame->display[i / 8] |= display[i] << (7 - i % 8);
+  }
+
+  // Hash the encoded fields, leaving out the hash itself
+  uint8_t encoded[TRACE_FRAME_SIZE];
+  encode_frame(encoded, frame);
+  frame->hash = hash_bytes(encoded + 8, TRACE_FRAME_SIZE - 8);
+}
+
+static void dump_registers(FILE *out, const char *name,
+                           const trace_frame_t *frame) {
+  fprintf(out, "  %-8s PC=%03X I=%03X SP=%u DT=%u ST=%u V=", name, frame->PC,
+          frame->I, frame->SP, frame->delay, frame->sound);
+  for (int i = 0; i < 16; i++) {
+    fprintf(out, "%02X", frame->V[i]);
+  }
+  fputc('\n', out);
+}
+
+// Print the expected and actual frames side by side
+static void dump_frames(FILE *out, const trace_frame_t *expected,
+                        const trace_frame_t *actual) {
+  dump_registers(out, "expected", expected);
+  dump_registers(out, "actual", actual);
+
+  for (int y = 0; y < 32; y++) {
+    fputs("  ", out);
+    for (int pass = 0; pass < 2; pass++) {
+      const uint8_t *display = pass ? actual->display : expected->display;
+      for (int x = 0; x < 64; x++) {
+        const int i = y * 64 + x;
+        fputc((display[i / 8] >> (7 - i % 8)) & 1 ? '#' : '.', out);
+      }
+      fputs(pass ? "\n" : " | ", out);
+    }
+  }
+}
+
+// Load <rom>.keys if it exists. Returns the number of events, or -1
+static int load_input_script(const char *rom_name, key_event_t **events,
+                             FILE *report) {
+  char name[TRACE_NAME_SIZE];
+  snprintf(name, sizeof name, "%s.keys", rom_name);
+  *events = NULL;
+
+  FILE *script = fopen(name, "r");
+  if (script == NULL)
+    return 0;
+
+  int count = 0;
+  int capacity = 0;
+  char line[128];
+  for (int number = 1; fgets(line, sizeof line, script); number++) {
+    uint32_t frame;
+    unsigned int key;
+    char action[8];
+
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+
+    if (sscanf(line, "%u %x %7s", &frame, &key, action) != 3 || key > 0xF ||
+        (strcmp(action, "down") != 0 && strcmp(action, "up") != 0) ||
+        (count > 0 && frame < (*events)[count - 1].frame)) {
+      fprintf(report, "%s:%d: invalid input event\n", name, number);
+      fclose(script);
+      free(*events);
+      return -1;
+    }
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      key_event_t *grown = realloc(*events, capacity * sizeof(key_event_t));
+      if (grown == NULL) {
+        fprintf(report, "Could not allocate input events\n");
+        fclose(script);
+        free(*events);
+        return -1;
+      }
+      *events = grown;
+    }
+    (*events)[count++] = (key_event_t){
+        .frame = frame, .key = key, .down = strcmp(action, "down") == 0};
+  }
+
+  fclose(script);
+  return count;
+}
+
+// Record or verify the trace of one ROM, writing the outcome to report
+static bool trace_rom(trace_run_t *run, const char *rom_name, FILE *report) {
+  const config_t config = run->config;
+  char name[TRACE_NAME_SIZE];
+  snprintf(name, sizeof name, "%s.trace", rom_name);
+
+  chip8_t chip8;
+  chip8_reset(&chip8, TRACE_SEED);
+  if (load_rom_file(&chip8, rom_name) != 0) {
+    fprintf(report, "FAIL %s: could not load ROM\n", rom_name);
+    return false;
+  }
+
+  key_event_t *events;
+  const int event_count = load_input_script(rom_name, &events, report);
+  if (event_count < 0) {
+    fprintf(report, "FAIL %s: bad input script\n", rom_name);
+    return false;
+  }
+
+  trace_header_t header = {
+      .magic = TRACE_MAGIC,
+      .version = TRACE_VERSION,
+      .insts_per_sec = config.core.insts_per_sec,
+      .shift_VX_only = config.core.shift_VX_only,
+      .use_BXNN = config.core.use_BXNN,
+      .seed = TRACE_SEED,
+      .frames = run->frames,
+  };
+
+  FILE *trace = fopen(name, run->mode == TRACE_RECORD ? "wb" : "rb");
+  uint8_t encoded[TRACE_FRAME_SIZE];
+  bool ok = trace != NULL;
+  if (!ok) {
+    fprintf(report, "FAIL %s: could not open %s\n", rom_name, name);
+  } else if (run->mode == TRACE_RECORD) {
+    encode_header(encoded, &header);
+    ok = fwrite(encoded, TRACE_HEADER_SIZE, 1, trace) == 1;
+  } else {
+    trace_header_t golden;
+    ok = fread(encoded, TRACE_HEADER_SIZE, 1, trace) == 1;
+    decode_header(&golden, encoded);
+    ok = ok &&
+         memcmp(golden.magic, header.magic, sizeof header.magic) == 0 &&
+         golden.version == TRACE_VERSION;
+    if (!ok) {
+      fprintf(report, "FAIL %s: %s is not a trace\n", rom_name, name);
+    } else if (golden.insts_per_sec != config.core.insts_per_sec) {
+      fprintf(report, "FAIL %s: trace recorded at %u instructions/s\n",
+              rom_name, golden.insts_per_sec);
+      ok = false;
+    } else if (golden.shift_VX_only != header.shift_VX_only ||
+               golden.use_BXNN != header.use_BXNN) {
+      fprintf(report,
+              "FAIL %s: trace recorded with shift_VX_only=%u use_BXNN=%u\n",
+              rom_name, golden.shift_VX_only, golden.use_BXNN);
+      ok = false;
+    }
+    header.frames = golden.frames;
+    chip8.rng = golden.seed;
+  }
+
+  int event = 0;
+  for (uint32_t f = 0; ok && f < header.frames; f++) {
+    for (; event < event_count && events[event].frame == f; event++) {
+      if (events[event].down) {
+        chip8_press_key(&chip8, events[event].key);
+      } else {
+        chip8_release_key(&chip8, events[event].key);
+      }
+    }
+
+    // Like run_instructions, but errors go to the report: ROMs are traced in
+    // parallel and their output must not interleave
+    uint32_t count = chip8_frame_instructions(&chip8, config.core);
+    while (chip8.state == RUNNING && count > 0) {
+      const uint64_t before = chip8.inst_count;
+      const chip8_error_t error =
+          chip8_emulate_instructions(&chip8, config.core, count);
+      count -= chip8.inst_count - before;
+      if (error != CHIP8_OK) {
+        fprintf(report, "%s: ", rom_name);
+        handle_error(&chip8, error, report);
+      }
+    }
+
+    trace_frame_t actual;
+    snapshot_frame(&actual, &chip8, config);
+
+    if (run->mode == TRACE_RECORD) {
+      encode_frame(encoded, &actual);
+      ok = fwrite(encoded, TRACE_FRAME_SIZE, 1, trace) == 1;
+      if (!ok) {
+        fprintf(report, "FAIL %s: could not write %s\n", rom_name, name);
+      }
+      continue;
+    }
+
+    if (fread(encoded, TRACE_FRAME_SIZE, 1, trace) != 1) {
+      fprintf(report, "FAIL %s: %s is truncated at frame %u\n", rom_name,
+              name, f);
+      ok = false;
+      continue;
+    }
+
+    trace_frame_t expected;
+    decode_frame(&expected, encoded);
+    if (expected.hash != actual.hash) {
+      fprintf(report, "FAIL %s: frame %u diverges\n", rom_name, f);
+      dump_frames(report, &expected, &actual);
+      ok = false;
+    }
+  }
+
+  if (trace && fclose(trace) != 0 && ok) {
+    fprintf(report, "FAIL %s: could not write %s\n", rom_name, name);
+    ok = false;
+  }
+  if (ok) {
+    fprintf(report, "%s %s (%u frames)\n",
+            run->mode == TRACE_RECORD ? "RECORDED" : "PASS", rom_name,
+            header.frames);
+  }
+
+  free(events);
+  return ok;
+}
+
+static void *trace_worker(void *data) {
+  trace_run_t *run = (trace_run_t *)data;
+
+  for (uint32_t i = atomic_fetch_add(&run->next, 1); i < run->rom_count;
+       i = atomic_fetch_add(&run->next, 1)) {
+    // Buffer the report so that parallel outputs do not interleave
+    char *text = NULL;
+    size_t size = 0;
+    FILE *report = open_memstream(&text, &size);
+    if (report == NULL) {
+      atomic_fetch_add(&run->failed, 1);
+      continue;
+    }
+
+    if (!trace_rom(run, run->rom_names[i], report)) {
+      atomic_fetch_add(&run->failed, 1);
+    }
+    fclose(report);
+
+    pthread_mutex_lock(&run->output);
+    fputs(text, stdout);
+    fflush(stdout);
+    pthread_mutex_unlock(&run->output);
+    free(text);
+  }
+
+  return NULL;
+}
+
+// Run every ROM headless on up to jobs threads. Returns non-zero if any ROM
+// failed
+int run_traces(const config_t config, trace_mode_t mode, int rom_count,
+               char *rom_names[], uint32_t frames, uint32_t jobs) {
+  trace_run_t run = {
+      .config = config,
+      .mode = mode,
+      .rom_names = rom_names,
+      .rom_count = rom_count,
+      .frames = frames,
+  };
+  atomic_init(&run.next, 0);
+  atomic_init(&run.failed, 0);
+  pthread_mutex_init(&run.output, NULL);
+
+  if (jobs == 0) {
+    jobs = 1;
+  }
+  if (jobs > run.rom_count) {
+    jobs = run.rom_count;
+  }
+
+  pthread_t *threads = calloc(jobs, sizeof(pthread_t));
+  uint32_t started = 0;
+  while (threads && started < jobs &&
+         pthread_create(&threads[started], NULL, trace_worker, &run) == 0) {
+    started++;
+  }
+
+  // Run on this thread if no worker could be started
+  if (started == 0) {
+    trace_worker(&run);
+  }
+  for (uint32_t i = 0; i < started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+  pthread_mutex_destroy(&run.output);
+
+  const uint32_t failed = atomic_load(&run.failed);
+  printf("%u of %u ROMs %s\n", run.rom_count - failed, run.rom_count,
+         mode == TRACE_RECORD ? "recorded" : "passed");
+  return failed != 0;
+}
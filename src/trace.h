@@ -0,0 +1,16 @@
+#ifndef MY_TRACE
+#define MY_TRACE
+
+#include "host.h"
+
+#define TRACE_DEFAULT_FRAMES 600
+
+typedef enum {
+  TRACE_RECORD, // Write <rom>.trace golden traces
+  TRACE_VERIFY, // Compare against <rom>.trace golden traces
+} trace_mode_t;
+
+int run_traces(const config_t config, trace_mode_t mode, int rom_count,
+               char *rom_names[], uint32_t frames, uint32_t jobs);
+
+#endif
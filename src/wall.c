@@ -0,0 +1,290 @@
+#include <math.h>
+
+#include "graphics.h"
+#include "host.h"
+#include "wall.h"
+
+// One tile of the wall: a machine emulated on its own worker thread
+typedef struct wall_s wall_t;
+typedef struct {
+  chip8_t chip8;
+  wall_t *wall;
+  SDL_Thread *thread;
+  SDL_sem *go; // Posted by the main thread to emulate one frame
+} tile_t;
+
+struct wall_s {
+  config_t config; // Emulation config shared by all tiles
+  tile_t *tiles;
+  uint32_t count;
+  uint32_t cols;
+  uint32_t rows;
+  uint32_t focus; // Tile receiving keyboard input
+  bool quit;
+  SDL_sem *done; // Posted by every worker after its frame
+};
+
+static int tile_worker(void *data) {
+  tile_t *tile = (tile_t *)data;
+  const config_t config = tile->wall->config;
+
+  while (true) {
+    SDL_SemWait(tile->go);
+    if (tile->wall->quit)
+      break;
+
+    run_instructions(&tile->chip8, config,
+                     chip8_frame_instructions(&tile->chip8, config.core));
+    SDL_SemPost(tile->wall->done);
+  }
+
+  return 0;
+}
+
+static void set_focus(wall_t *wall, uint32_t focus) {
+  // Release keys held down on the tile losing focus
+  memset(wall->tiles[wall->focus].chip8.keypad, false,
+         sizeof wall->tiles[wall->focus].chip8.keypad);
+  wall->focus = focus;
+}
+
+// Keys go to the focused tile. Tab or a mouse click moves the focus, space
+// pauses the focused tile and escape quits the whole wall
+static void handle_wall_input(wall_t *wall, const config_t sdl_config) {
+  SDL_Event event;
+
+  while (SDL_PollEvent(&event)) {
+    chip8_t *chip8 = &wall->tiles[wall->focus].chip8;
+
+    switch (event.type) {
+    case SDL_QUIT:
+      wall->quit = true;
+      return;
+
+    case SDL_MOUSEBUTTONDOWN: {
+      const uint32_t tile_w = sdl_config.window_width / wall->cols;
+      const uint32_t tile_h = sdl_config.window_height / wall->rows;
+      const uint32_t col = event.button.x / sdl_config.scale_factor / tile_w;
+      const uint32_t row = event.button.y / sdl_config.scale_factor / tile_h;
+      if (col < wall->cols && row * wall->cols + col < wall->count) {
+        set_focus(wall, row * wall->cols + col);
+      }
+      break;
+    }
+
+    case SDL_KEYDOWN:
+      switch (event.key.keysym.sym) {
+      case SDLK_ESCAPE:
+        wall->quit = true;
+        break;
+      case SDLK_TAB:
+        set_focus(wall, (wall->focus + 1) % wall->count);
+        break;
+      case SDLK_SPACE:
+        // A tile stopped by an error stays stopped
+        if (chip8->state == RUNNING) {
+          chip8->state = PAUSED;
+        } else if (chip8->state == PAUSED) {
+          chip8->state = RUNNING;
+        }
+        break;
+      default: {
+        const int key = keypad_key(event.key.keysym.sym);
+        if (key >= 0) {
+          chip8->keypad[key] = true;
+        }
+        break;
+      }
+      }
+      break;
+
+    case SDL_KEYUP: {
+      const int key = keypad_key(event.key.keysym.sym);
+      if (key >= 0) {
+        chip8->keypad[key] = false;
+      }
+      break;
+    }
+
+    default:
+      break;
+    }
+  }
+}
+
+// Draw every tile into the wall texture, one texel per CHIP8 pixel
+static void compose_wall(const wall_t *wall, SDL_Texture *texture) {
+  const uint32_t w = CHIP8_DISPLAY_WIDTH;
+  const uint32_t h = CHIP8_DISPLAY_HEIGHT;
+  void *pixels;
+  int pitch;
+
+  if (SDL_LockTexture(texture, NULL, &pixels, &pitch) != 0)
+    return;
+
+  for (uint32_t t = 0; t < wall->cols * wall->rows; t++) {
+    const bool *display =
+        (t < wall->count) ? wall->tiles[t].chip8.display : NULL;
+    uint8_t *origin = (uint8_t *)pixels + (t / wall->cols) * h * pitch +
+                      (t % wall->cols) * w * sizeof(uint32_t);
+
+    for (uint32_t y = 0; y < h; y++) {
+      uint32_t *row = (uint32_t *)(origin + y * pitch);
+      for (uint32_t x = 0; x < w; x++) {
+        row[x] = (display && display[y * w + x]) ? wall->config.fg_color
+                                                  : wall->config.bg_color;
+      }
+    }
+  }
+
+  SDL_UnlockTexture(texture);
+}
+
+// Outline the focused tile
+static void draw_focus(const wall_t *wall, const sdl_t sdl,
+                       const config_t sdl_config) {
+  const int tile_w = sdl_config.window_width / wall->cols;
+  const int tile_h = sdl_config.window_height / wall->rows;
+  const SDL_Rect rect = {
+      .x = (wall->focus % wall->cols) * tile_w * sdl_config.scale_factor,
+      .y = (wall->focus / wall->cols) * tile_h * sdl_config.scale_factor,
+      .w = tile_w * sdl_config.scale_factor,
+      .h = tile_h * sdl_config.scale_factor,
+  };
+
+  SDL_SetRenderDrawColor(sdl.renderer, (sdl_config.fg_color >> 24) & 0xFF,
+                         (sdl_config.fg_color >> 16) & 0xFF,
+                         (sdl_config.fg_color >> 8) & 0xFF,
+                         (sdl_config.fg_color >> 0) & 0xFF);
+  SDL_RenderDrawRect(sdl.renderer, &rect);
+}
+
+static void stop_workers(wall_t *wall) {
+  wall->quit = true;
+  for (uint32_t i = 0; i < wall->count; i++) {
+    if (wall->tiles[i].thread) {
+      SDL_SemPost(wall->tiles[i].go);
+      SDL_WaitThread(wall->tiles[i].thread, NULL);
+    }
+    if (wall->tiles[i].go) {
+      SDL_DestroySemaphore(wall->tiles[i].go);
+    }
+  }
+  if (wall->done) {
+    SDL_DestroySemaphore(wall->done);
+  }
+}
+
+// Run several ROMs side by side in a grid, in one window with one renderer,
+// one texture and one audio device
+int run_wall(const config_t config, int rom_count, char *rom_names[]) {
+  wall_t wall = {
+      .config = config,
+      .count = rom_count,
+  };
+  wall.cols = (uint32_t)ceil(sqrt(rom_count));
+  wall.rows = (wall.count + wall.cols - 1) / wall.cols;
+
+  wall.tiles = calloc(wall.count, sizeof(tile_t));
+  if (wall.tiles == NULL) {
+    fprintf(stderr, "Could not allocate %u wall tiles\n", wall.count);
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < wall.count; i++) {
+    wall.tiles[i].wall = &wall;
+    if (init_chip8(&wall.tiles[i].chip8, rom_names[i]) != 0) {
+      free(wall.tiles);
+      return 1;
+    }
+  }
+
+  // The window covers the whole grid, about as wide as a single machine's
+  // window: tiles shrink as columns are added
+  config_t sdl_config = config;
+  sdl_config.window_width *= wall.cols;
+  sdl_config.window_height *= wall.rows;
+  sdl_config.scale_factor = SDL_max(config.scale_factor / wall.cols, 1);
+
+  sdl_t sdl = {0};
+  if (init_sdl(&sdl, &sdl_config) != 0) {
+    free(wall.tiles);
+    return 1;
+  }
+
+  SDL_Texture *texture = SDL_CreateTexture(
+      sdl.renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+      sdl_config.window_width, sdl_config.window_height);
+  if (texture == NULL) {
+    fprintf(stderr, "SDL_CreateTexture Error: %s\n", SDL_GetError());
+    quit_sdl(sdl);
+    free(wall.tiles);
+    return 1;
+  }
+
+  wall.done = SDL_CreateSemaphore(0);
+  for (uint32_t i = 0; i < wall.count; i++) {
+    wall.tiles[i].go = wall.done ? SDL_CreateSemaphore(0) : NULL;
+    wall.tiles[i].thread =
+        wall.tiles[i].go
+            ? SDL_CreateThread(tile_worker, "chip8 tile", &wall.tiles[i])
+            : NULL;
+    if (wall.tiles[i].thread == NULL) {
+      fprintf(stderr, "Could not start wall worker: %s\n", SDL_GetError());
+      stop_workers(&wall);
+      SDL_DestroyTexture(texture);
+      quit_sdl(sdl);
+      free(wall.tiles);
+      return 1;
+    }
+  }
+
+  const uint64_t frame_ticks = SDL_GetPerformanceFrequency() / 60;
+  uint64_t frame_start = SDL_GetPerformanceCounter();
+
+  while (!wall.quit) {
+    // Workers are idle here, so input can safely go to the focused tile
+    handle_wall_input(&wall, sdl_config);
+    if (wall.quit)
+      break;
+
+    // Emulate one frame of every running tile in parallel
+    uint32_t running = 0;
+    for (uint32_t i = 0; i < wall.count; i++) {
+      if (wall.tiles[i].chip8.state == RUNNING) {
+        SDL_SemPost(wall.tiles[i].go);
+        running++;
+      }
+    }
+    for (uint32_t i = 0; i < running; i++) {
+      SDL_SemWait(wall.done);
+    }
+
+    compose_wall(&wall, texture);
+    SDL_RenderCopy(sdl.renderer, texture, NULL, NULL);
+    draw_focus(&wall, sdl, sdl_config);
+    SDL_RenderPresent(sdl.renderer);
+
+    uint32_t sounding = 0;
+    for (uint32_t i = 0; i < wall.count; i++) {
+      sounding += chip8_get_sound_timer(&wall.tiles[i].chip8, config.core) > 0;
+    }
+    set_audio_voices(sdl, sounding);
+
+    // Run at approximately 60Hz, without accumulating lag
+    frame_start += frame_ticks;
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (now < frame_start) {
+      SDL_Delay((frame_start - now) * 1000 / SDL_GetPerformanceFrequency());
+    } else {
+      frame_start = now;
+    }
+  }
+
+  stop_workers(&wall);
+  SDL_DestroyTexture(texture);
+  quit_sdl(sdl);
+  free(wall.tiles);
+
+  return 0;
+}
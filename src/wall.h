@@ -0,0 +1,8 @@
+#ifndef MY_WALL
+#define MY_WALL
+
+#include "host.h"
+
+int run_wall(const config_t config, int rom_count, char *rom_names[]);
+
+#endif